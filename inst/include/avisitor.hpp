@@ -36,6 +36,7 @@ class NH3Component;
 class OceanComponent;
 class SulfurComponent;
 class OzoneComponent;
+struct tracking_table;
 
 //------------------------------------------------------------------------------
 /*! \brief AVisitor abstract class provides a base for subclasses to visit only
@@ -65,6 +66,12 @@ public:
    */
   virtual void outputTrackingData(std::ostream &tracking_out) const {}
 
+  //------------------------------------------------------------------------------
+  /*! \brief Append the Tracking Data, if applicable, to a table of columns.
+   *  \param table The table to add rows to.
+   */
+  virtual void outputTrackingTable(tracking_table &table) const {}
+
   //------------------------------------------------------------------------------
   // Add a visit for all visitable subclasses here.
   // TODO: should we create a .cpp for these?
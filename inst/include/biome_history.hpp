@@ -0,0 +1,435 @@
+/* Hector -- A Simple Climate Model
+   Copyright (C) 2022  Battelle Memorial Institute
+
+   Please see the accompanying file LICENSE.md for additional licensing
+   information.
+*/
+#ifndef BIOME_HISTORY_H
+#define BIOME_HISTORY_H
+/*
+ *  biome_history.hpp - Per-biome values recorded over time.
+ *
+ *  This plays the role of a `tvector<std::vector<T>>` for the biome-specific
+ *  state of the land carbon model, but stores it by column: one contiguous
+ *  array of doubles per biome, indexed by record (year). Recording a year
+ *  therefore appends one number per biome rather than copying a vector of
+ *  fluxpools, each with its own name string and source map.
+ *
+ *  For fluxpools, the units and name are kept once per biome, and the
+ *  carbon-tracking source fractions are stored separately, only for the
+ *  records in which tracking was on.
+ *
+ *  The sum over biomes of each record is kept alongside, so that a global
+ *  value at a given date costs no more than a biome's.
+ *
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "fluxpool.hpp"
+#include "h_exception.hpp"
+
+namespace Hector {
+
+/*! \brief Time history of a per-biome quantity (double or fluxpool).
+ *
+ *  Records are kept in date order. Years are normally recorded
+ *  consecutively, so a lookup first tries the record at the date's offset
+ *  from the last one, and falls back to a binary search when there are gaps
+ *  (e.g. between the spinup record at t=0 and the start date). As with
+ *  tvector, truncating the end of the history does not free anything; the
+ *  storage is reused when the history is refilled.
+ */
+template <class T_data> class biome_history {
+  static constexpr bool is_fluxpool = std::is_same<T_data, fluxpool>::value;
+
+  //! One biome's history
+  struct column {
+    std::vector<double> values; //!< value at each record
+    // fluxpool only:
+    unit_types units = U_UNDEFINED; //!< units of the values
+    std::string name;               //!< name of the fluxpool
+    //! Source fractions at each record; no sources means tracking was
+    //! off. Only allocated (up to the last tracked record) once tracking
+    //! has been on.
+    std::vector<source_fractions> fractions;
+  };
+
+  std::vector<double> dates;  //!< date of each record, increasing
+  std::vector<column> biomes; //!< history of each biome
+  //! Sum over biomes of each record, in biome order
+  mutable std::vector<double> totals;
+  //! Have the totals to be recomputed (after a biome was removed)?
+  mutable bool totals_stale = false;
+
+public:
+  /*! \brief Read-only view of a run of recorded values, without copying
+   *
+   *  Valid until the history is next modified.
+   */
+  class view {
+  public:
+    view(const double *first, std::size_t n) : first(first), n(n) {}
+    const double *begin() const { return first; }
+    const double *end() const { return first + n; }
+    std::size_t size() const { return n; }
+    double operator[](std::size_t i) const { return first[i]; }
+
+  private:
+    const double *first;
+    std::size_t n;
+  };
+
+  void set(double, const std::vector<T_data> &);
+  void get(double, std::vector<T_data> &) const;
+  T_data get(double, std::size_t) const;
+  double value(double, std::size_t) const;
+  double sum(double) const;
+  unit_types units() const;
+  bool exists(double) const;
+
+  double firstdate() const;
+  double lastdate() const;
+  int size() const { return int(dates.size()); }
+  std::size_t nbiomes() const { return biomes.size(); }
+
+  view record_dates() const { return view(dates.data(), dates.size()); }
+  view biome_values(std::size_t ib) const;
+  view sums() const;
+
+  void truncate(double t);
+
+  void add_biome(const T_data &init_value);
+  void remove_biome(std::size_t ib);
+
+private:
+  std::size_t find(double t) const;
+  std::size_t row(double t) const;
+  void store(column &col, std::size_t i, const T_data &d);
+  T_data at(const column &col, std::size_t i) const;
+  void update_total(std::size_t i) const;
+  void refresh_totals() const;
+
+  static double round(double t) {
+    // round time values as tvector does
+    return 0.5 * ::round(2.0 * t);
+  }
+};
+
+//-----------------------------------------------------------------------
+/*! \brief Index of the record at time t, or dates.size() if there is none
+ */
+template <class T_data>
+std::size_t biome_history<T_data>::find(double t) const {
+  t = round(t);
+  if (dates.empty()) {
+    return 0;
+  }
+  // Usual case: consecutive years, so the offset from the last record
+  // gives the index directly
+  const double offset = dates.back() - t;
+  if (offset >= 0 && offset < dates.size()) {
+    const std::size_t i = dates.size() - 1 - std::size_t(offset);
+    if (dates[i] == t) {
+      return i;
+    }
+  }
+  auto itr = std::lower_bound(dates.begin(), dates.end(), t);
+  if (itr != dates.end() && *itr == t) {
+    return std::size_t(itr - dates.begin());
+  }
+  return dates.size();
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Index of the record at time t; raise an exception if none
+ */
+template <class T_data>
+std::size_t biome_history<T_data>::row(double t) const {
+  const std::size_t i = find(t);
+  if (i == dates.size()) {
+    std::ostringstream errmsg;
+    errmsg << "No data at requested time= " << round(t) << "\n";
+    H_THROW(errmsg.str());
+  }
+  return i;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Store one biome's value in record i
+ */
+template <class T_data>
+void biome_history<T_data>::store(column &col, std::size_t i,
+                                  const T_data &d) {
+  if constexpr (is_fluxpool) {
+    col.values[i] = d.value(d.units());
+    col.units = d.units();
+    col.name = d.name;
+    if (d.tracking) {
+      if (col.fractions.size() <= i) {
+        col.fractions.resize(i + 1);
+      }
+      col.fractions[i] = d.get_source_fractions();
+    } else if (i < col.fractions.size()) {
+      col.fractions[i].clear();
+    }
+  } else {
+    col.values[i] = d;
+  }
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Record the per-biome values d at time t
+ *
+ *  Overwrites an existing record at t. A new record after the last one is
+ *  appended; one before it (rare: e.g. setting a pool at a past date) is
+ *  inserted in place.
+ */
+template <class T_data>
+void biome_history<T_data>::set(double t, const std::vector<T_data> &d) {
+  t = round(t);
+  if (dates.empty()) {
+    biomes.clear();
+    biomes.resize(d.size());
+    totals.clear();
+    totals_stale = false;
+  }
+  H_ASSERT(d.size() == biomes.size(), "biome count mismatch in history");
+
+  std::size_t i = find(t);
+  if (i == dates.size()) {
+    // New record
+    i = std::size_t(std::lower_bound(dates.begin(), dates.end(), t) -
+                    dates.begin());
+    dates.insert(dates.begin() + i, t);
+    totals.insert(totals.begin() + i, 0.0);
+    for (auto &col : biomes) {
+      col.values.insert(col.values.begin() + i, 0.0);
+      if (i < col.fractions.size()) {
+        col.fractions.insert(col.fractions.begin() + i, source_fractions());
+      }
+    }
+  }
+  for (std::size_t ib = 0; ib < d.size(); ++ib) {
+    store(biomes[ib], i, d[ib]);
+  }
+  update_total(i);
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Recompute the sum over biomes of record i
+ */
+template <class T_data>
+void biome_history<T_data>::update_total(std::size_t i) const {
+  double total = 0.0;
+  for (const auto &col : biomes) {
+    total = total + col.values[i];
+  }
+  totals[i] = total;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Recompute the sums over biomes, if they are out of date
+ */
+template <class T_data> void biome_history<T_data>::refresh_totals() const {
+  if (totals_stale) {
+    totals.resize(dates.size());
+    for (std::size_t i = 0; i < dates.size(); ++i) {
+      update_total(i);
+    }
+    totals_stale = false;
+  }
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Restore the per-biome values at time t into d
+ *
+ *  d is resized to the number of biomes if need be; for fluxpools, each
+ *  is rebuilt with its recorded units, name, and (if tracking was on)
+ *  source fractions.
+ */
+template <class T_data>
+void biome_history<T_data>::get(double t, std::vector<T_data> &d) const {
+  const std::size_t i = row(t);
+  d.resize(biomes.size());
+  for (std::size_t ib = 0; ib < biomes.size(); ++ib) {
+    d[ib] = at(biomes[ib], i);
+  }
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Return one biome's value at time t
+ */
+template <class T_data>
+T_data biome_history<T_data>::get(double t, std::size_t ib) const {
+  H_ASSERT(ib < biomes.size(), "biome index out of range in history");
+  return at(biomes[ib], row(t));
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Rebuild one biome's value from record i
+ */
+template <class T_data>
+T_data biome_history<T_data>::at(const column &col, std::size_t i) const {
+  if constexpr (is_fluxpool) {
+    const bool tracked = i < col.fractions.size() && !col.fractions[i].empty();
+    fluxpool fp(col.values[i], col.units, tracked, col.name);
+    if (tracked) {
+      fp.set_source_fractions(col.fractions[i]);
+    }
+    return fp;
+  } else {
+    return col.values[i];
+  }
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Return one biome's value at time t as a number (no allocation)
+ */
+template <class T_data>
+double biome_history<T_data>::value(double t, std::size_t ib) const {
+  H_ASSERT(ib < biomes.size(), "biome index out of range in history");
+  return biomes[ib].values[row(t)];
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Return the sum over biomes of the values at time t
+ *
+ *  The sums are kept as records are set, so this is a lookup.
+ */
+template <class T_data> double biome_history<T_data>::sum(double t) const {
+  H_ASSERT(biomes.size(), "can't sum an empty map");
+  const std::size_t i = row(t);
+  refresh_totals();
+  return totals[i];
+}
+
+//-----------------------------------------------------------------------
+/*! \brief View of one biome's values, in record order
+ */
+template <class T_data>
+typename biome_history<T_data>::view
+biome_history<T_data>::biome_values(std::size_t ib) const {
+  H_ASSERT(ib < biomes.size(), "biome index out of range in history");
+  return view(biomes[ib].values.data(), dates.size());
+}
+
+//-----------------------------------------------------------------------
+/*! \brief View of the sums over biomes, in record order
+ */
+template <class T_data>
+typename biome_history<T_data>::view biome_history<T_data>::sums() const {
+  refresh_totals();
+  return view(totals.data(), dates.size());
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Units of the recorded values (fluxpool histories)
+ */
+template <class T_data> unit_types biome_history<T_data>::units() const {
+  H_ASSERT(biomes.size(), "no biomes in history");
+  return biomes.front().units;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Does a record exist at time t?
+ */
+template <class T_data> bool biome_history<T_data>::exists(double t) const {
+  return find(t) != dates.size();
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Return the date of the first record
+ */
+template <class T_data> double biome_history<T_data>::firstdate() const {
+  H_ASSERT(dates.size(), "no data");
+  return dates.front();
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Return the date of the last record
+ */
+template <class T_data> double biome_history<T_data>::lastdate() const {
+  H_ASSERT(dates.size(), "no data");
+  return dates.back();
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Drop all records after time t
+ *
+ *  The arrays keep their capacity, so refilling them does not allocate.
+ */
+template <class T_data> void biome_history<T_data>::truncate(double t) {
+  t = round(t);
+  const std::size_t n = std::size_t(
+      std::upper_bound(dates.begin(), dates.end(), t) - dates.begin());
+  dates.resize(n);
+  totals.resize(n);
+  for (auto &col : biomes) {
+    col.values.resize(n);
+    if (col.fractions.size() > n) {
+      col.fractions.resize(n);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Add a biome, set to `init_value` in every record
+ *
+ *  New biomes always go at the end. This allocates the biome's one new
+ *  column and fills it; nothing else in the history is touched.
+ */
+template <class T_data>
+void biome_history<T_data>::add_biome(const T_data &init_value) {
+  if (dates.empty()) {
+    return; // the next set() sizes the history
+  }
+  biomes.emplace_back();
+  column &col = biomes.back();
+  double v;
+  if constexpr (is_fluxpool) {
+    v = init_value.value(init_value.units());
+    col.units = init_value.units();
+    col.name = init_value.name;
+    if (init_value.tracking) {
+      col.fractions.assign(dates.size(),
+                           init_value.get_source_fractions());
+    }
+  } else {
+    v = init_value;
+  }
+  col.values.assign(dates.size(), v);
+
+  // The new biome is last, so adding it to the sums keeps them in biome
+  // order
+  if (!totals_stale) {
+    for (double &total : totals) {
+      total = total + v;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Remove the biome at index `ib` from every record
+ *
+ *  Only the biome's own column is freed; the columns after it move down
+ *  one place, without copying their records.
+ */
+template <class T_data>
+void biome_history<T_data>::remove_biome(std::size_t ib) {
+  if (dates.empty()) {
+    return;
+  }
+  H_ASSERT(ib < biomes.size(), "biome index out of range in history");
+  biomes.erase(biomes.begin() + ib);
+  totals_stale = true; // recomputed when next needed
+}
+
+} // namespace Hector
+
+#endif
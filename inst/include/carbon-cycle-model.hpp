@@ -14,6 +14,7 @@
  * Created by Robert, March 2011.
  */
 
+#include <limits>
 #include <string>
 
 #include "core.hpp"
@@ -75,6 +76,22 @@ public:
   //! that is stored in the class's member variables.
   virtual int calcderivs(double t, const double c[], double dcdt[]) const = 0;
 
+  //! Calculate the Jacobian of the derivatives and store in J.
+  //! \details J is an nc x nc row-major array, J[i*nc + j] =
+  //! d(dc_i/dt)/dc_j, evaluated at the same (t, c; params) as
+  //! calcderivs.  The default implementation uses forward differences of
+  //! calcderivs; models should override it with an analytic version.
+  virtual int calcjacobian(double t, const double c[], double J[]) const;
+
+  //! Calculate the fluxes between the carbon pools and store in F.
+  //! \details F is an nc x nc row-major array of non-negative fluxes:
+  //! F[i*nc + j] (i != j) is the flux from pool j into pool i, and
+  //! F[i*nc + i] is the flux out of pool i that leaves the model
+  //! altogether.  The derivatives are then dc_i/dt = sum over j != i of
+  //! (F[i*nc + j] - F[j*nc + i]), minus F[i*nc + i].  Only the
+  //! positivity-preserving integrators need this; the default throws.
+  virtual int calcfluxes(double t, const double c[], double F[]) const;
+
   //! Calculate updates to the model's "slowly varying" variables.
 
   //! \details The model is allowed to have certain variables that are
@@ -90,6 +107,16 @@ public:
   //! Copy the C values back into the model, restore units, etc.
   virtual void stashCValues(double t, const double c[]) = 0;
 
+  //! Longest interval the solver may integrate before stashing the pools.
+
+  //! \details Some models (e.g. the ocean's chemistry) are only valid for
+  //! a limited time past the last getCValues or stashCValues call.  The
+  //! solver places a breakpoint, and calls stashCValues, so that no
+  //! integration interval is longer than this.  The default is no limit.
+  virtual double max_stash_interval() const {
+    return std::numeric_limits<double>::infinity();
+  }
+
   //! Record the final state at the end of a time step
 
   //! \details This method should copy all state variables into a
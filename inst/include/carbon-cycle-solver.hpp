@@ -14,16 +14,41 @@
  *
  */
 
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "carbon-cycle-model.hpp"
 #include "h_util.hpp"
 #include "logger.hpp"
+#include "tseries.hpp"
+#include "unitval.hpp"
 
 #define MAX_CARBON_MODEL_RETRIES 8
 
+// Integrators that can be selected with the `integrator` input
+#define CCS_INTEGRATOR_DOPRI5 "dopri5"
+#define CCS_INTEGRATOR_RK4_FIXED "rk4_fixed"
+#define CCS_INTEGRATOR_CASH_KARP "cash_karp"
+#define CCS_INTEGRATOR_ROSENBROCK4 "rosenbrock4"
+#define CCS_INTEGRATOR_BULIRSCH_STOER "bulirsch_stoer"
+#define CCS_INTEGRATOR_MPRK22 "mprk22"
+
 namespace Hector {
 
+class ODEIntegrator;
+
+//! Step-size controller state carried from one solver interval to the next
+struct ODEStepHistory {
+  ODEStepHistory() : next_step(0.0) {}
+  //! Step proposed by the controller at the end of the last interval
+  //! (years; 0 if none)
+  double next_step;
+  //! Derivatives at the start of the last interval, to detect jumps
+  std::vector<double> dxdt;
+};
+
 /*! \brief The carbon cycle solver component
  *
  * The strategy in this solver is to write the carbon cycle as
@@ -53,6 +78,12 @@ public:
   //! Return a carbon pool value. Components will know which one they want.
   double cpool(int i) const { return c[i]; }
 
+  unsigned long rhsEvaluations() const;
+
+  //! Number of sub-annual pool samples kept for each year (0 if none)
+  int samplesPerYear() const { return samples_per_year; }
+  const double *getPoolSamples(double year) const;
+
   // IModelComponent methods
   std::string getComponentName() const {
     return std::string(CCS_COMPONENT_NAME);
@@ -94,27 +125,42 @@ private:
   double eps_abs;
   //! Relative error tolerance for integration
   double eps_rel;
-  //! Default stepsize (years) -- the integrator will adjust this as required
+  //! Initial stepsize (years) -- the integrator will adjust this as
+  //! required, carrying its step from year to year (for the fixed-step
+  //! integrator, the maximum step)
   double dt;
+  //! Name of the ODE integrator to use (one of the CCS_INTEGRATOR_* names)
+  std::string integrator_name;
 
   unitval eps_spinup; //! spinup epsilon (drift/tolerance), Pg C
 
-  struct bad_derivative_exception {
-    bad_derivative_exception(const int status) : errorFlag(status) {}
-    int errorFlag;
-  };
-  // A functor to provide callbacks for the ODE solver.
-  struct ODEEvalFunctor {
-    ODEEvalFunctor(CarbonCycleModel *cmodel, double *time)
-        : modelptr(cmodel), t(time) {}
-    void operator()(const std::vector<double> &y, std::vector<double> &dydt,
-                    double t);
-    void operator()(const std::vector<double> &y, double t);
-    CarbonCycleModel *modelptr;
-    double *t;
-  };
+  //! ODE stepper and controller, kept across years so that the yearly
+  //! solve does not allocate.  Defined in the .cpp to keep odeint out of
+  //! this header.
+  std::unique_ptr<ODEIntegrator> integrator;
+
+  //! Controller state at the end of each year, so that a reset run
+  //! restarts from the same steps as the original
+  std::map<double, ODEStepHistory> step_history;
+
+  //! Solver statistics for the last year run: derivative evaluations,
+  //! steps accepted and rejected by the error controller, retries requested
+  //! by the carbon model, and the smallest step taken (years)
+  unitval rhs_evals, accepted_steps, rejected_steps, retries, min_step;
+  tseries<unitval> rhs_evals_ts, accepted_steps_ts, rejected_steps_ts,
+      retries_ts, min_step_ts;
+
+  //! Integrator counters at the last log report
+  unsigned long last_rhs_evals, last_accepted_steps, last_rejected_steps;
+
+  //! Pool values sampled within each year of the main run, taken from the
+  //! integrator's dense output: samples_per_year rows of nc values per
+  //! year, starting with the first year after the start date
+  int samples_per_year;
+  std::vector<double> pool_samples;
 
   void failure(int stat, double t0, double tmid);
+  void log_solver_work(const std::string &what);
 
   bool in_spinup;
 
@@ -25,10 +25,15 @@
 #define D_START_DATE "startDate"
 #define D_END_DATE "endDate"
 #define D_TRACKING_DATE "trackingDate"
+#define D_TRACKING_ENGINE "trackingEngine"
+#define D_TRACKING_POOLS "trackingPools"
+#define D_TRACKING_MAX_SOURCES "trackingMaxSources"
+#define D_TRACKING_MIN_FRACTION "trackingMinFraction"
 #define D_DO_SPINUP "do_spinup"
 #define D_MAX_SPINUP "max_spinup"
 #define D_ENABLED "enabled"
 #define D_OUTPUT_ENABLED "output"
+#define D_COMPONENTS "components"
 
 // bc component
 #define D_EMISSIONS_BC "BC_emissions"
@@ -38,6 +43,13 @@
 #define D_CCS_EPS_REL "eps_rel"
 #define D_CCS_DT "dt"
 #define D_EPS_SPINUP "eps_spinup"
+#define D_CCS_INTEGRATOR "integrator"
+#define D_CCS_SAMPLES_PER_YEAR "samples_per_year"
+#define D_CCS_RHS_EVALS "solver_rhs_evals"
+#define D_CCS_ACCEPTED_STEPS "solver_accepted_steps"
+#define D_CCS_REJECTED_STEPS "solver_rejected_steps"
+#define D_CCS_RETRIES "solver_retries"
+#define D_CCS_MIN_STEP "solver_min_step"
 
 // forcing component
 #define D_RF_PREFIX "RF_"
@@ -15,6 +15,7 @@
  */
 
 #include <algorithm>
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
@@ -23,10 +24,16 @@
 #include "ivisitable.hpp"
 #include "logger.hpp"
 
+// Carbon tracking engines (see D_TRACKING_ENGINE)
+#define TRACKING_ENGINE_FLUXPOOL "fluxpool" //!< fluxpools carry their sources
+#define TRACKING_ENGINE_LEDGER "ledger"     //!< sources found after the run
+
 namespace Hector {
 
 class unitval;
 struct message_data;
+struct source_limits;
+struct tracking_table;
 class IModelComponent;
 
 //------------------------------------------------------------------------------
@@ -83,7 +90,12 @@ public:
   double getStartDate() const { return startDate; };
   double getEndDate() const { return endDate; };
   double getTrackingDate() const { return trackingDate; };
+  bool trackingByLedger() const {
+    return trackingEngine == TRACKING_ENGINE_LEDGER;
+  };
+  source_limits getTrackingLimits() const;
   std::string getTrackingData() const;
+  tracking_table getTrackingTable() const;
   double getCurrentDate() const { return lastDate; }
   std::string getRun_name() const { return run_name; };
   bool inSpinup() const { return in_spinup; };
@@ -94,6 +106,13 @@ public:
   }
   void addModelComponent(IModelComponent *modelComponent);
 
+  //! Function that constructs a new model component
+  typedef std::function<IModelComponent *()> ComponentFactory;
+  static void registerComponentFactory(const std::string &componentName,
+                                       ComponentFactory factory);
+  static std::vector<std::string> getRegisteredComponents();
+  void setComponentList(const std::vector<std::string> &components);
+
   // IVisitable methods
   virtual void accept(AVisitor *visitor);
 
@@ -128,6 +147,18 @@ private:
   // prepareToRun.
   bool setup_complete;
 
+  //! Is the spun-up state at the start date consistent with the current
+  //! inputs?  If so, a reset to before the start date can simply rewind
+  //! to the start date instead of rerunning the spinup.
+  bool spinup_current;
+
+  //! Registry of component factories, keyed by component name
+  static std::map<std::string, ComponentFactory> &componentFactories();
+
+  //! Components to construct at init; empty means all registered components
+  std::vector<std::string> selectedComponents;
+  bool componentSelected(const std::string &componentName) const;
+
   //! Cause all components to run their spinup procedure.
   bool run_spinup();
 
@@ -151,6 +182,18 @@ private:
   //! The date to start tracking carbon cycle flows
   double trackingDate;
 
+  //------------------------------------------------------------------------------
+  //! How carbon sources are tracked: TRACKING_ENGINE_FLUXPOOL or
+  //! TRACKING_ENGINE_LEDGER
+  std::string trackingEngine;
+
+  //------------------------------------------------------------------------------
+  //! Tracking controls: the pools to track (all, if empty), the most sources
+  //! kept per pool, and the smallest fraction kept (see source_limits)
+  std::vector<std::string> trackingPools;
+  std::size_t trackingMaxSources;
+  double trackingMinFraction;
+
   //------------------------------------------------------------------------------
   //! A flag to indicate that the core has been initialized.
   bool isInited;
@@ -34,6 +34,7 @@ public:
 
   virtual void visit(Core *c);
   virtual void visit(ForcingComponent *c);
+  virtual void visit(CarbonCycleSolver *c);
   virtual void visit(SimpleNbox *c);
   virtual void visit(HalocarbonComponent *c);
   virtual void visit(TemperatureComponent *c);
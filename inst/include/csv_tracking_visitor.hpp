@@ -14,21 +14,32 @@
  *
  */
 
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "avisitor.hpp"
+#include "flux_ledger.hpp"
 #include "fluxpool.hpp"
-#include "tseries.hpp"
 
 #define DELIMITER ","
 
 namespace Hector {
 /*! \brief A visitor which will the contents of each tracked pool at each model
  * period.
+ *
+ *  Rows are kept by column, and appended as each year is visited. By default
+ *  each year's rows are also written to the output stream once the year is
+ *  complete (i.e. when the next one is visited), rather than all at the end.
+ *  A reset drops the rows after the reset date from the columns, using the
+ *  first row of each year; rows already written to the stream stay there.
  */
 class CSVFluxPoolVisitor : public AVisitor {
 public:
-  CSVFluxPoolVisitor(std::ostream &outputStream, const bool printHeader = true);
+  CSVFluxPoolVisitor(std::ostream &outputStream, const bool printHeader = true,
+                     const bool streamOutput = true);
   ~CSVFluxPoolVisitor();
 
   virtual bool shouldVisit(const bool in_spinup, const double date);
@@ -38,16 +49,38 @@ public:
 
   void reset(const double reset_date);
   virtual void outputTrackingData(std::ostream &tracking_out) const;
+  virtual void outputTrackingTable(tracking_table &table) const;
 
 private:
   //! The file output stream in which the csv output will be written to.
   std::ostream &csvFile;
+  //! Whether completed years are written to csvFile as the model runs
+  bool stream_output;
+  //! Rows already written to csvFile, and whether the header has been
+  std::size_t flushed_rows;
+  bool header_flushed;
+
+  //! The tracking data, one entry per row; components and pools are
+  //! indices into `names`
+  struct row_columns {
+    std::vector<double> year;
+    std::vector<std::uint16_t> component, pool;
+    std::vector<double> pool_value; //!< Pg C
+    std::vector<source_id> source;
+    std::vector<double> fraction;
+  } rows;
+  //! Each year that has rows, and its first row
+  std::vector<std::pair<double, std::size_t>> year_rows;
+  std::vector<std::string> names;
+  std::unordered_map<std::string, std::uint16_t> name_index;
+  std::uint16_t name_id(const std::string &name);
 
-  //! The buffer—holds output until ready to be returned to the core or written
-  //! to the csv file
-  tseries<string> csvBuffer;
   string header;
 
+  //! Tracking controls: which pools are output, and (with the ledger) how
+  //! many of their sources
+  source_limits limits;
+
   // Data retained while the visitor is operating
   double current_date;
   double tracking_date;
@@ -61,9 +94,17 @@ private:
   //! Name of current run
   string run_name;
 
-  //! Helper function: print one or more lines of tracking data for a given
-  //! fluxpool
-  virtual void print_pool(const fluxpool, const string);
+  //! Helper function: add lines of tracking data for a given fluxpool
+  void print_pool(const fluxpool &x, std::uint16_t component);
+  void truncate_rows(double date);
+  void write_rows(std::ostream &out, std::size_t begin, std::size_t end) const;
+
+  //! The land model's flux ledger, when tracking by ledger; the tracking
+  //! data are then found from it when they are output
+  const flux_ledger *ledger;
+  std::vector<std::size_t> ledger_pools() const;
+  void output_ledger(std::ostream &tracking_out) const;
+  void output_ledger(tracking_table &table) const;
 
   //! Pointers to other components and stuff
   Core *core;
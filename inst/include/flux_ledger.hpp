@@ -0,0 +1,109 @@
+/* Hector -- A Simple Climate Model
+   Copyright (C) 2022  Battelle Memorial Institute
+
+   Please see the accompanying file LICENSE.md for additional licensing
+   information.
+*/
+#ifndef FLUX_LEDGER_H
+#define FLUX_LEDGER_H
+/*
+ *  flux_ledger.hpp
+ *  hector
+ *
+ *  Post-hoc carbon source attribution. Instead of carrying source fractions
+ *  in every fluxpool as the model runs, the ledger records how much carbon
+ *  moved between each pair of pools in each year, and the pool sizes at the
+ *  end of each year. Source fractions are reconstructed afterwards, only for
+ *  the pools and years asked for.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "fluxpool.hpp"
+
+namespace Hector {
+
+//-----------------------------------------------------------------------
+/*! \brief Annual inter-pool carbon flows, and the source fractions they imply
+ *
+ *  Pools are registered, with their sizes, when tracking starts; that state
+ *  is the end of the year before the first tracked year, and each pool is
+ *  then entirely its own source. Each following year holds a pools x pools
+ *  flow matrix, stored sparsely: only pool pairs that ever exchange carbon
+ *  have an entry. Carbon from outside the tracked pools (the OUTSIDE pool)
+ *  is attributed to the "untracked" source, as the fluxpool engine does;
+ *  carbon leaving to OUTSIDE (e.g. as CH4) just leaves.
+ *
+ *  Attribution treats each pool as well mixed over a year: its composition
+ *  at the end of year y is that of its size at the end of year y-1 plus the
+ *  year's inflows, each with its source pool's composition at the end of
+ *  year y-1. Outflows leave the composition unchanged. This is the fluxpool
+ *  engine's arithmetic at an annual rather than a solver step, so the two
+ *  agree closely but not exactly. Fractions are computed on first request,
+ *  year by year from the start, and kept.
+ */
+class flux_ledger {
+public:
+  //! The pool index standing for everything outside the tracked pools
+  static constexpr std::size_t OUTSIDE = std::numeric_limits<std::size_t>::max();
+
+  void start(double year);
+  void clear();
+  //! Whether tracking has started
+  bool active() const { return !years.empty(); }
+
+  std::size_t add_pool(const std::string &component, const std::string &name,
+                       double size);
+  void begin_year(double year);
+  void add_flux(std::size_t from, std::size_t to, double amount);
+  void set_pool_size(std::size_t pool, double size);
+  void truncate(double year);
+
+  //! Number of pools
+  std::size_t size() const { return pools.size(); }
+  const std::string &pool_component(std::size_t pool) const {
+    return pools.at(pool).component;
+  }
+  const std::string &pool_name(std::size_t pool) const {
+    return source_name(pools.at(pool).source);
+  }
+  double first_year() const;
+  double last_year() const;
+  double get_flux(std::size_t from, std::size_t to, double year) const;
+  double pool_size(std::size_t pool, double year) const;
+  const source_fractions &get_fractions(std::size_t pool, double year) const;
+
+private:
+  struct pool_info {
+    std::string component;
+    source_id source; //!< the pool's name, as a source
+  };
+  struct year_record {
+    double year;
+    std::vector<double> flow; //!< carbon moved along each edge, Pg C
+    std::vector<double> size; //!< pool sizes at the end of the year, Pg C
+  };
+
+  std::vector<pool_info> pools;
+  //! The (from, to) pool pairs that have exchanged carbon
+  std::vector<std::pair<std::size_t, std::size_t>> edges;
+  std::unordered_map<std::uint64_t, std::size_t> edge_index;
+  //! years[0] holds the starting sizes; each later record is one year
+  std::vector<year_record> years;
+  //! Source fractions of every pool, for years[0..fractions.size())
+  mutable std::vector<std::vector<source_fractions>> fractions;
+
+  std::size_t year_index(double year) const;
+  void propagate() const;
+};
+
+} // namespace Hector
+
+#endif // FLUX_LEDGER_H
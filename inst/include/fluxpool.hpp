@@ -9,9 +9,13 @@
 */
 
 #include "unitval.hpp"
-#include <algorithm> // std::set_union
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -26,21 +30,129 @@ using namespace std;
  *  Created by Ben on 2021-02-05.
  *  Tracking implementation 2021 by Skylar Gering, Harvey Mudd College
  *
+ *  Source names are interned as small integer ids, and a fluxpool's sources
+ *  are held in a small array sorted by id, so that the arithmetic of
+ *  tracking does not hash strings. The sources are held apart from the
+ *  pool, and only once it is tracked: an untracked fluxpool is just its
+ *  value, units and name, and its arithmetic neither allocates nor interns.
+ *
  */
 
 namespace Hector {
 
+//! Interned id of a carbon-tracking source name
+typedef std::uint16_t source_id;
+
+source_id intern_source(const string &name);
+const string &source_name(source_id id);
+
+//-----------------------------------------------------------------------
+/*! \brief The fractions of a pool that came from each of its sources.
+ *
+ *  A small dense map from source id to fraction, kept sorted by id. With a
+ *  single biome there are only a dozen or so pools that carbon can come
+ *  from, and up to INLINE_SOURCES are held in place; each extra biome adds
+ *  five pools, and beyond INLINE_SOURCES the sources spill to the heap.
+ */
+class source_fractions {
+public:
+  //! Sources held without allocating
+  static constexpr std::size_t INLINE_SOURCES = 16;
+
+  source_fractions() : n(0) {}
+
+  std::size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+  void clear() {
+    n = 0;
+    spill_ids.clear();
+    spill_fracs.clear();
+  }
+
+  //! The i'th source, in id order
+  source_id id(std::size_t i) const { return id_data()[i]; }
+  double fraction(std::size_t i) const { return frac_data()[i]; }
+
+  double get(source_id src) const;
+  void set(source_id src, double frac);
+
+  static source_fractions merge(double lhs_val, const source_fractions &lhs,
+                                double rhs_val, const source_fractions &rhs,
+                                double total);
+  source_fractions limit(std::size_t max_sources, double min_fraction,
+                         source_id other) const;
+
+  friend bool operator==(const source_fractions &,
+                         const source_fractions &);
+
+private:
+  std::size_t n;                 //!< number of sources
+  source_id ids[INLINE_SOURCES]; //!< source ids, increasing
+  double fracs[INLINE_SOURCES];  //!< fraction from each source
+  //! All the sources instead, once there are more than INLINE_SOURCES
+  std::vector<source_id> spill_ids;
+  std::vector<double> spill_fracs;
+
+  bool spilled() const { return !spill_ids.empty(); }
+  const source_id *id_data() const {
+    return spilled() ? spill_ids.data() : ids;
+  }
+  const double *frac_data() const {
+    return spilled() ? spill_fracs.data() : fracs;
+  }
+  double *frac_data() { return spilled() ? spill_fracs.data() : fracs; }
+  void spill();
+  void push_back(source_id src, double frac);
+};
+
+//-----------------------------------------------------------------------
+/*! \brief The value of an untracked flux or pool.
+ *
+ *  Just a value, which may not be negative, and its units: sixteen bytes,
+ *  trivially copyable, and without the name and source fractions that every
+ *  fluxpool carries. Flux arithmetic that does not need carbon tracking is
+ *  done on these, and the result stored back with fluxpool::set_fluxval().
+ */
+class fluxval {
+public:
+  fluxval() : val(0.0), valUnits(U_UNDEFINED) {}
+  fluxval(double v, unit_types u);
+
+  double value(unit_types u) const;
+  unit_types units() const { return valUnits; }
+  operator unitval() const { return unitval(val, valUnits); }
+
+  friend fluxval operator+(const fluxval &, const fluxval &);
+  friend fluxval operator-(const fluxval &, const fluxval &);
+  friend fluxval operator*(const fluxval &, const double);
+  friend fluxval operator/(const fluxval &, const double);
+  friend double operator/(const fluxval &, const fluxval &);
+
+private:
+  double val;
+  unit_types valUnits;
+};
+
+static_assert(sizeof(fluxval) == 16 &&
+                  std::is_trivially_copyable<fluxval>::value,
+              "fluxval should be a plain 16-byte value");
+
 class fluxpool : public unitval {
 
 public:
   fluxpool();
   fluxpool(double, unit_types, bool, string);
   void set(double, unit_types, bool, string);
+  fluxval get_fluxval() const { return fluxval(val, valUnits); }
+  void set_fluxval(const fluxval &);
 
   // tracking-specific functions
   vector<string> get_sources() const;
   double get_fraction(string source) const;
   unordered_map<string, double> get_tracking_map() const;
+  void set_tracking_map(const unordered_map<string, double> &);
+  const source_fractions &get_source_fractions() const { return fractions(); }
+  void set_source_fractions(const source_fractions &);
   bool tracking;
   string name;
   fluxpool flux_from_unitval(unitval, string) const;
@@ -59,22 +171,233 @@ public:
   friend bool operator==(const fluxpool &, const fluxpool &);
   friend bool operator!=(const fluxpool &, const fluxpool &);
 
-  friend ostream &operator<<(ostream &, fluxpool &);
+  friend ostream &operator<<(ostream &, const fluxpool &);
 
 private:
-  // private constructor used only when adding
-  fluxpool(unitval, unordered_map<string, double>, bool, string);
-  // tracking information is held in a map <source name, fraction of total>
-  unordered_map<string, double> ctmap;
+  typedef std::shared_ptr<const source_fractions> fractions_ptr;
+  // private constructor used by the arithmetic
+  fluxpool(unitval, const fractions_ptr &, bool, string);
+  // Tracking information: the fraction of the total from each source. It
+  // is never modified, only replaced, so copies of the pool share it; it
+  // is null until needed, the pool until then being entirely its own
+  // source, so untracked pools have none. A default-constructed pool has
+  // no sources at all.
+  mutable fractions_ptr ctmap;
+  const source_fractions &fractions() const;
+  static const fractions_ptr &no_sources();
+};
+
+void check_source_fractions(const source_fractions &, const string &);
+
+//-----------------------------------------------------------------------
+/*! \brief Bounds on the sources tracked in each pool, from the core's
+ *         tracking controls.
+ *
+ *  If `pools` is not empty, only the pools named in it are followed; the
+ *  fractions of every other pool are reset to the pool itself, so that the
+ *  carbon leaving it is attributed to it, and it is left out of the tracking
+ *  output. The followed pools keep at most max_sources sources, none with a
+ *  fraction below min_fraction; the rest are merged into "other".
+ */
+struct source_limits {
+  //! No limit on the number of sources
+  static constexpr std::size_t ALL_SOURCES =
+      std::numeric_limits<std::size_t>::max();
+
+  source_limits();
+
+  vector<string> pools;    //!< pools to follow; empty for all
+  std::size_t max_sources; //!< most sources per pool, besides "other"
+  double min_fraction;     //!< smaller fractions are merged into "other"
+
+  bool selected(const string &pool) const;
+  bool limited() const {
+    return !pools.empty() || max_sources < ALL_SOURCES || min_fraction > 0;
+  }
+  source_fractions limit(const source_fractions &fractions) const;
+  void apply(fluxpool &pool) const;
 };
 
+//-----------------------------------------------------------------------
+/*! \brief Fraction from a source; 0 if it is not one of ours
+ */
+inline double source_fractions::get(source_id src) const {
+  const source_id *id = id_data();
+  for (std::size_t i = 0; i < n; ++i) {
+    if (id[i] == src) {
+      return frac_data()[i];
+    }
+  }
+  return 0.0;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Move the sources to the heap, to make room for more
+ */
+inline void source_fractions::spill() {
+  spill_ids.assign(ids, ids + n);
+  spill_fracs.assign(fracs, fracs + n);
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Add a source after all the others; ids must be added in order
+ */
+inline void source_fractions::push_back(source_id src, double frac) {
+  if (!spilled() && n < INLINE_SOURCES) {
+    ids[n] = src;
+    fracs[n] = frac;
+  } else {
+    if (!spilled()) {
+      spill();
+    }
+    spill_ids.push_back(src);
+    spill_fracs.push_back(frac);
+  }
+  ++n;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Set the fraction from a source, adding it if necessary
+ */
+inline void source_fractions::set(source_id src, double frac) {
+  const source_id *id = id_data();
+  std::size_t i = 0;
+  while (i < n && id[i] < src) {
+    ++i;
+  }
+  if (i < n && id[i] == src) {
+    frac_data()[i] = frac;
+  } else if (i == n) {
+    push_back(src, frac);
+  } else if (!spilled() && n < INLINE_SOURCES) {
+    for (std::size_t j = n; j > i; --j) {
+      ids[j] = ids[j - 1];
+      fracs[j] = fracs[j - 1];
+    }
+    ids[i] = src;
+    fracs[i] = frac;
+    ++n;
+  } else {
+    if (!spilled()) {
+      spill();
+    }
+    spill_ids.insert(spill_ids.begin() + i, src);
+    spill_fracs.insert(spill_fracs.begin() + i, frac);
+    ++n;
+  }
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Source fractions of the sum of two pools
+ *  \param lhs_val Size of the first pool
+ *  \param lhs Its source fractions
+ *  \param rhs_val Size of the second pool
+ *  \param rhs Its source fractions
+ *  \param total Size of the sum
+ *
+ *  The result has the union of the sources, including any whose fraction is
+ *  zero. If the total is zero, the sources share it equally.
+ */
+inline source_fractions
+source_fractions::merge(double lhs_val, const source_fractions &lhs,
+                        double rhs_val, const source_fractions &rhs,
+                        double total) {
+  source_fractions out;
+  const source_id *lid = lhs.id_data(), *rid = rhs.id_data();
+  const double *lfrac = lhs.frac_data(), *rfrac = rhs.frac_data();
+  if (lhs.n == rhs.n && std::equal(lid, lid + lhs.n, rid)) {
+    // Usual case: the same sources on both sides
+    for (std::size_t i = 0; i < lhs.n; ++i) {
+      out.push_back(lid[i], lhs_val * lfrac[i] + rhs_val * rfrac[i]);
+    }
+  } else {
+    std::size_t i = 0, j = 0;
+    while (i < lhs.n || j < rhs.n) {
+      source_id src;
+      double fl = 0.0, fr = 0.0;
+      if (j == rhs.n || (i < lhs.n && lid[i] < rid[j])) {
+        src = lid[i];
+        fl = lfrac[i++];
+      } else if (i == lhs.n || rid[j] < lid[i]) {
+        src = rid[j];
+        fr = rfrac[j++];
+      } else {
+        src = lid[i];
+        fl = lfrac[i++];
+        fr = rfrac[j++];
+      }
+      out.push_back(src, lhs_val * fl + rhs_val * fr);
+    }
+  }
+
+  // Convert the sources' amounts to fractions of the total
+  double *frac = out.frac_data();
+  for (std::size_t i = 0; i < out.n; ++i) {
+    frac[i] = total ? frac[i] / total : 1.0 / out.n;
+  }
+  return out;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Same sources, with the same fractions
+ */
+inline bool operator==(const source_fractions &lhs,
+                       const source_fractions &rhs) {
+  return lhs.n == rhs.n &&
+         std::equal(lhs.id_data(), lhs.id_data() + lhs.n, rhs.id_data()) &&
+         std::equal(lhs.frac_data(), lhs.frac_data() + lhs.n,
+                    rhs.frac_data());
+}
+
 // Non-member function for multiplication with double as first argument
 fluxpool operator*(double d, const fluxpool &ct);
 
+//-----------------------------------------------------------------------
+/*! \brief Constructor; the value may not be negative
+ */
+inline fluxval::fluxval(double v, unit_types u) : val(v), valUnits(u) {
+  H_ASSERT(v >= 0, "Flux and pool values may not be negative");
+}
+
+//-----------------------------------------------------------------------
+/*! \brief The value, which must be in units u
+ */
+inline double fluxval::value(unit_types u) const {
+  H_ASSERT(u == valUnits, "variable is not of this type.  Expected: " +
+                              unitval::unitsName(valUnits) +
+                              "; got: " + unitval::unitsName(u));
+  return val;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Operator overloads: the arithmetic of fluxpool, without tracking
+ */
+inline fluxval operator+(const fluxval &lhs, const fluxval &rhs) {
+  H_ASSERT(lhs.valUnits == rhs.valUnits, "units mismatch");
+  return fluxval(lhs.val + rhs.val, lhs.valUnits);
+}
+inline fluxval operator-(const fluxval &lhs, const fluxval &rhs) {
+  H_ASSERT(lhs.valUnits == rhs.valUnits, "units mismatch");
+  return fluxval(lhs.val - rhs.val, lhs.valUnits);
+}
+inline fluxval operator*(const fluxval &lhs, const double rhs) {
+  return fluxval(lhs.val * rhs, lhs.valUnits);
+}
+inline fluxval operator*(const double lhs, const fluxval &rhs) {
+  return rhs * lhs;
+}
+inline fluxval operator/(const fluxval &lhs, const double rhs) {
+  return fluxval(lhs.val / rhs, lhs.valUnits);
+}
+inline double operator/(const fluxval &lhs, const fluxval &rhs) {
+  H_ASSERT(lhs.valUnits == rhs.valUnits, "units mismatch");
+  return lhs.val / rhs.val;
+}
+
 //-----------------------------------------------------------------------
 /*! \brief Public constructor
  */
-inline fluxpool::fluxpool() {
+inline fluxpool::fluxpool() : ctmap(no_sources()) {
   tracking = false;
   name = "?";
 }
@@ -88,52 +411,72 @@ inline fluxpool::fluxpool(double v, unit_types u, bool track = false,
 }
 
 //-----------------------------------------------------------------------
-/*! \brief Private constructor with explicit source pool map
+/*! \brief Private constructor with explicit (shared) source fractions
  */
-inline fluxpool::fluxpool(unitval v, unordered_map<string, double> pool_map,
-                          bool track = true, string pool_name = "?") {
+inline fluxpool::fluxpool(unitval v, const fractions_ptr &pool_map,
+                          bool track = true, string pool_name = "?")
+    : ctmap(pool_map) {
   unitval::set(v.value(v.units()), v.units(), 0.0);
   tracking = track;
-  ctmap = pool_map;
   name = pool_name;
 
-  if (v < 0) {
-    H_ASSERT(v >= 0, "Flux and pool values may not be negative in " + name);
-  }
-
-  // check pool_map data
-  double frac = 0.0;
-  for (auto src : ctmap) {
-    H_ASSERT(src.second >= 0 && src.second <= 1,
-             "fractions must be 0-1 for " + pool_name);
-    frac += src.second;
-  }
-  H_ASSERT(frac - 1.0 < 1e-6, "pool_map must sum to ~1.0 for " + pool_name)
+  H_ASSERT(v >= 0, "Flux and pool values may not be negative in " + name);
 }
 
 //-----------------------------------------------------------------------
 /*! \brief Check that the value is >=0 before passing control to unitval
- *  \warning Resets map so 'name' key's value is 1, all others removed
+ *  \warning Resets the 'name' key's value to 1
  */
 inline void fluxpool::set(double v, unit_types u, bool track = false,
                           string pool_name = "?") {
   name = pool_name;
-  if (v < 0) {
-    H_ASSERT(v >= 0, "Flux and pool values may not be negative in " + name);
-  }
+  H_ASSERT(v >= 0, "Flux and pool values may not be negative in " + name);
   tracking = track;
-  ctmap[name] = 1.0;
+  ctmap.reset(); // its own source
+  // Interned now, although its fractions are made only when needed, so
+  // that source ids (and the order of sources) follow pool creation
+  intern_source(name);
   unitval::set(v, u, 0.0);
 }
 
+//-----------------------------------------------------------------------
+/*! \brief The source fractions, made on first use if the pool is still
+ *         entirely its own source
+ */
+inline const source_fractions &fluxpool::fractions() const {
+  if (!ctmap) {
+    auto own = std::make_shared<source_fractions>();
+    own->set(intern_source(name), 1.0);
+    ctmap = std::move(own);
+  }
+  return *ctmap;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief The (shared) empty source fractions of a default-constructed pool
+ */
+inline const fluxpool::fractions_ptr &fluxpool::no_sources() {
+  static const fractions_ptr empty = std::make_shared<source_fractions>();
+  return empty;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Replace the value of an untracked fluxpool, keeping its name
+ */
+inline void fluxpool::set_fluxval(const fluxval &v) {
+  H_ASSERT(!tracking, "set_fluxval() requires tracking to be off in " + name);
+  unitval::set(v.value(v.units()), v.units(), 0.0);
+}
+
 //-----------------------------------------------------------------------
 /*! \brief Return a string vector of the current sources
  */
 inline vector<string> fluxpool::get_sources() const {
   H_ASSERT(tracking, "get_sources() requires tracking to be on in " + name);
+  const source_fractions &sf = fractions();
   vector<string> sources;
-  for (auto src : ctmap) {
-    sources.push_back(src.first);
+  for (std::size_t i = 0; i < sf.size(); ++i) {
+    sources.push_back(source_name(sf.id(i)));
   }
   return sources;
 }
@@ -143,19 +486,48 @@ inline vector<string> fluxpool::get_sources() const {
  */
 inline double fluxpool::get_fraction(string source) const {
   H_ASSERT(tracking, "get_fraction() requires tracking to be on in " + name);
-  double val = 0.0; // 0.0 is returned if not in our map
-  auto x = ctmap.find(source);
-  if (x != ctmap.end()) {
-    val = x->second;
+  const source_fractions &sf = fractions();
+  for (std::size_t i = 0; i < sf.size(); ++i) {
+    if (source_name(sf.id(i)) == source) {
+      return sf.fraction(i);
+    }
   }
-  return val;
+  return 0.0; // 0.0 is returned if not in our map
 }
 
 //-----------------------------------------------------------------------
 /*! \brief Return the whole map
  */
 inline unordered_map<string, double> fluxpool::get_tracking_map() const {
-  return this->ctmap;
+  const source_fractions &sf = fractions();
+  unordered_map<string, double> pool_map;
+  for (std::size_t i = 0; i < sf.size(); ++i) {
+    pool_map[source_name(sf.id(i))] = sf.fraction(i);
+  }
+  return pool_map;
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Replace the whole map, e.g. when restoring a recorded state
+ */
+inline void fluxpool::set_tracking_map(
+    const unordered_map<string, double> &pool_map) {
+  H_ASSERT(tracking, "set_tracking_map() requires tracking to be on in " + name);
+  source_fractions fractions;
+  for (auto &src : pool_map) {
+    fractions.set(intern_source(src.first), src.second);
+  }
+  check_source_fractions(fractions, name);
+  ctmap = std::make_shared<const source_fractions>(std::move(fractions));
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Replace the source fractions with ones recorded earlier
+ */
+inline void fluxpool::set_source_fractions(const source_fractions &fractions) {
+  H_ASSERT(tracking,
+           "set_source_fractions() requires tracking to be on in " + name);
+  ctmap = std::make_shared<const source_fractions>(fractions);
 }
 
 //-----------------------------------------------------------------------
@@ -165,12 +537,18 @@ inline unordered_map<string, double> fluxpool::get_tracking_map() const {
  */
 inline fluxpool fluxpool::flux_from_unitval(unitval f,
                                             string name = "?") const {
+  if (tracking) {
+    fractions(); // the flux has a different name, but our sources
+  }
   return fluxpool(f, ctmap, tracking, name);
 }
 
 inline fluxpool fluxpool::flux_from_fluxpool(fluxpool f,
                                              string name = "?") const {
   unitval flux = unitval(f.value(f.valUnits), valUnits);
+  if (tracking) {
+    fractions(); // as in flux_from_unitval()
+  }
   return fluxpool(flux, ctmap, tracking, name);
 }
 
@@ -201,57 +579,18 @@ inline fluxpool operator+(const fluxpool &lhs, const fluxpool &rhs) {
            "tracking mismatch: " + lhs.name + " and " + rhs.name)
 
   if (!lhs.tracking) {
-    return fluxpool(lhs.val + rhs.val, lhs.units(), false, lhs.name);
+    return fluxpool(unitval(lhs.val + rhs.val, lhs.units()),
+                    fluxpool::fractions_ptr(), false, lhs.name);
   }
 
-  // This is the complicated case, and the heart of the tracking capability
-
-  // Compute the overall new total (a unitval)
+  // This is the complicated case, and the heart of the tracking capability:
+  // each source's share of the total is the sum of its shares of the two
+  // sides (see source_fractions::merge)
   Hector::unitval new_total(lhs.val + rhs.val, lhs.units());
-
-  // Construct a vector of the combined sources
-  vector<string> lhs_src = lhs.get_sources(), rhs_src = rhs.get_sources(),
-                 both_sources;
-  // I was using set_union, which works in Xcode but but for some reason Rcpp
-  // builds are erroring on the required std::rbegin and std::rend usage.
-  /*
-      std::set_union(begin( lhs_src ), end( lhs_src ),
-                     rbegin( rhs_src ), rend( rhs_src ),
-                     back_inserter( both_sources ) );
-    */
-  // So, go with hand-built solution: look through lhs and then rhs sources
-  // If a source isn't in our "both_sources" vector, add it
-  for (auto &s : lhs_src) {
-    if (find(both_sources.begin(), both_sources.end(), s) ==
-        both_sources.end()) {
-      both_sources.push_back(s);
-    }
-  }
-  for (auto &s : rhs_src) {
-    if (find(both_sources.begin(), both_sources.end(), s) ==
-        both_sources.end()) {
-      both_sources.push_back(s);
-    }
-  }
-
-  // Walk through the sources and compute the combined absolute value
-  // Note get_fraction() return 0 if source not found, which is what we want
-  unordered_map<string, unitval> new_pools;
-  for (auto &s : both_sources) {
-    new_pools[s] =
-        unitval(lhs.val * lhs.get_fraction(s) + rhs.val * rhs.get_fraction(s),
-                lhs.units());
-  }
-
-  // Now that we have the new pool values, compute new fractions
-  unordered_map<string, double> new_origins;
-  for (auto &s : both_sources) {
-    if (new_total) {
-      new_origins[s] = new_pools[s] / new_total;
-    } else { // uh oh, new total is zero
-      new_origins[s] = 1.0 / new_pools.size();
-    }
-  }
+  auto new_origins = std::make_shared<const source_fractions>(
+      source_fractions::merge(lhs.val, lhs.fractions(), rhs.val,
+                              rhs.fractions(), new_total.value(lhs.units())));
+  check_source_fractions(*new_origins, lhs.name);
 
   return fluxpool(new_total, new_origins, lhs.tracking, lhs.name);
 }
@@ -263,8 +602,8 @@ inline fluxpool operator+(const fluxpool &lhs, const fluxpool &rhs) {
 inline fluxpool operator+(const fluxpool &lhs, const unitval &rhs) {
   H_ASSERT(lhs.valUnits == rhs.units(), "units mismatch: " + lhs.name);
   H_ASSERT(!lhs.tracking, "Can't add a unitval to a tracking fluxpool");
-  return fluxpool(lhs.val + rhs.value(rhs.units()), lhs.valUnits, false,
-                  lhs.name);
+  return fluxpool(unitval(lhs.val + rhs.value(rhs.units()), lhs.valUnits),
+                  fluxpool::fractions_ptr(), false, lhs.name);
 }
 
 //-----------------------------------------------------------------------
@@ -336,7 +675,7 @@ inline bool operator!=(const fluxpool &lhs, const fluxpool &rhs) {
 //-----------------------------------------------------------------------
 /*! \brief Printing, including tracking information if available
  */
-inline ostream &operator<<(ostream &out, fluxpool &rhs) {
+inline ostream &operator<<(ostream &out, const fluxpool &rhs) {
   out << rhs.value(rhs.units()) << " " << rhs.unitsName();
   if (rhs.tracking) {
     out << endl;
@@ -37,6 +37,7 @@ public:
   ~INIToCoreReader();
 
   void parse(const std::string &filename);
+  void parseComponentList(const std::string &filename);
 
 private:
   //! Weak reference to a Core object that will handle parsed values
@@ -52,6 +53,8 @@ private:
 
   static int valueHandler(void *user, const char *section, const char *name,
                           const char *value);
+  static int componentListHandler(void *user, const char *section,
+                                  const char *name, const char *value);
 
   typedef std::string::const_iterator StringIter;
   static double parseTSeriesIndex(const StringIter startBracket,
@@ -0,0 +1,104 @@
+/* Hector -- A Simple Climate Model
+   Copyright (C) 2022  Battelle Memorial Institute
+
+   Please see the accompanying file LICENSE.md for additional licensing
+   information.
+*/
+#ifndef LOGNORMAL_CDF_H
+#define LOGNORMAL_CDF_H
+/*
+ *  lognormal_cdf.hpp
+ *  hector
+ *
+ *  Tabulated cumulative distribution function of the lognormal distribution,
+ *  used for the permafrost thaw model (Woodard et al. 2021).
+ *
+ */
+
+#include <cmath>
+#include <vector>
+
+namespace Hector {
+
+//-----------------------------------------------------------------------
+/*! \brief Cumulative distribution function of a lognormal distribution.
+ *
+ *  The lognormal CDF is the standard normal CDF, Phi(z), of
+ *  z = (ln(x) - mu) / sigma. Phi is tabulated once (on first use) and shared
+ *  by every instance, whatever its mu and sigma, and by every thread; an
+ *  instance just holds its parameters. Between the tabulated points Phi is
+ *  evaluated by cubic Hermite interpolation using its exact derivative, the
+ *  normal density. This is monotone, and agrees with
+ *  boost::math::cdf(boost::math::lognormal(mu, sigma), x) to within
+ *  MAX_ERROR.
+ */
+class lognormal_cdf {
+public:
+  lognormal_cdf(double mu = 0.0, double sigma = 1.0);
+
+  double operator()(double x) const;
+
+  double mu() const { return m_mu; }
+  double sigma() const { return m_sigma; }
+
+  //! Maximum absolute error of the tabulated CDF
+  static constexpr double MAX_ERROR = 1e-10;
+
+private:
+  double m_mu;
+  double m_sigma;
+  double m_inv_sigma;
+
+  //! Phi(z) is tabulated for -Z_MAX <= z <= 0; beyond that it is 0 to
+  //! within MAX_ERROR (Phi(-8) ~ 6e-16). Phi(z) for z > 0 is 1 - Phi(-z).
+  static constexpr double Z_MAX = 8.0;
+  //! Points per unit z; the interpolation error is below 1e-11
+  static constexpr int Z_STEPS = 128;
+  static constexpr int TABLE_SIZE = int(Z_MAX) * Z_STEPS + 1;
+
+  //! Phi and its derivative (scaled by the step) at each tabulated point
+  struct node {
+    double phi;
+    double dphi;
+  };
+  const node *m_table; //!< the shared table, see table()
+
+  static const std::vector<node> &table();
+  double lower_tail(double z) const;
+};
+
+//-----------------------------------------------------------------------
+/*! \brief Evaluate the lognormal CDF, P(X <= x)
+ */
+inline double lognormal_cdf::operator()(double x) const {
+  if (x <= 0.0) {
+    return 0.0;
+  }
+  const double z = (std::log(x) - m_mu) * m_inv_sigma;
+  return z <= 0.0 ? lower_tail(z) : 1.0 - lower_tail(-z);
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Interpolate Phi(z) for z <= 0 from the table
+ */
+inline double lognormal_cdf::lower_tail(double z) const {
+  if (z <= -Z_MAX) {
+    return 0.0;
+  }
+  const double u = (z + Z_MAX) * Z_STEPS;
+  int i = int(u);
+  if (i >= TABLE_SIZE - 1) {
+    i = TABLE_SIZE - 2;
+  }
+  const double t = u - i;
+  const double s = 1.0 - t;
+  const node &a = m_table[i];
+  const node &b = m_table[i + 1];
+  // Cubic Hermite basis functions
+  return (1.0 + 2.0 * t) * s * s * a.phi + t * s * s * a.dphi +
+         t * t * (3.0 - 2.0 * t) * b.phi - t * t * s * b.dphi;
+}
+
+} // namespace Hector
+
+#endif // LOGNORMAL_CDF_H
@@ -26,6 +26,7 @@
 #define OCEAN_MIN_TIMESTEP 0.3 //!< minimum timestep (yr)
 #define OCEAN_TSR_FACTOR 0.5   //!< timestep reduction factor when necessary
 #define OCEAN_TSR_TIMEOUT 20   //!< years we lock into reduced timestep
+#define OCEAN_TIMESTEP_TOL 1e-9 //!< rounding allowed past max timestep (yr)
 #define OCEAN_TSR_TRIGGER1                                                     \
   0.1 //!< trigger1 to reduce timestep:
       //!< absolute diff between successive annual fluxes (Pg C)
@@ -72,10 +73,16 @@ public:
   // Carbon cycle model interface
   void getCValues(double t, double c[]);
   int calcderivs(double t, const double c[], double dcdt[]) const;
+  void calcfluxjacobian(double t, const double c[], double &dflux_datmos,
+                        double &dflux_docean) const;
   void slowparameval(double t, const double c[]);
   void stashCValues(double t, const double c[]);
+  double max_stash_interval() const { return max_timestep; }
   void record_state(double t);
   void set_atmosphere_sources(fluxpool atm) { atmosphere_cpool = atm; };
+  void start_ledger(flux_ledger *ledger, std::size_t atmos);
+  void record_ledger_sizes() const;
+  void limit_tracked_sources(const source_limits &limits);
   fluxpool get_oaflux() const;
   fluxpool get_aoflux() const;
 
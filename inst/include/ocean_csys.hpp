@@ -55,6 +55,7 @@ public:
   void ocean_csys_run(unitval tbox, unitval carbon);
   unitval calc_annual_surface_flux(const unitval &CO2_conc,
                                    const double cpoolscale = 1.0) const;
+  double annual_flux_coefficient() const;
   unitval get_K0() const { return K0; };
   unitval get_Tr() const { return Tr; };
 
@@ -22,6 +22,7 @@
 #include <string>
 #include <vector>
 
+#include "flux_ledger.hpp"
 #include "fluxpool.hpp"
 #include "logger.hpp"
 #include "ocean_csys.hpp"
@@ -61,6 +62,10 @@ private:
   fluxpool ao_flux; //!< atmosphere -> ocean flux
   fluxpool oa_flux; //!< ocean -> atmosphere flux
 
+  flux_ledger *ledger;     //!< ledger recording our fluxes, if any
+  std::size_t ledger_pool; //!< our pool in the ledger
+  std::size_t ledger_atmos; //!< the atmosphere's pool in the ledger
+
 public:
   oceanbox(); // constructor
 
@@ -69,21 +74,26 @@ public:
 
   void initbox(double C, std::string name = "");
   void make_connection(oceanbox *ob, const double k, const int window);
-  void compute_fluxes(const unitval current_Ca, const fluxpool atmosphere_cpool,
-                      const double yf, const bool do_circ = true);
+  void compute_fluxes(const unitval current_Ca,
+                      const fluxpool &atmosphere_cpool, const double yf,
+                      const bool do_circ = true);
   void log_state();
   void update_state();
   void new_year(const unitval SST);
-  void separate_surface_fluxes(fluxpool atmosphere_pool);
+  void separate_surface_fluxes(const fluxpool &atmosphere_pool);
 
   void set_carbon(const unitval C);
-  fluxpool get_carbon() const { return carbon; };
+  const fluxpool &get_carbon() const { return carbon; };
   fluxpool get_oa_flux() const { return oa_flux; };
   fluxpool get_ao_flux() const { return ao_flux; };
 
-  void add_carbon(fluxpool C);
+  void add_carbon(const fluxpool &C);
+  void add_carbon(const fluxval &C);
 
   void start_tracking();
+  void start_ledger(flux_ledger *ledger, std::size_t atmos);
+  void record_ledger_size() const;
+  void limit_sources(const source_limits &limits) { limits.apply(carbon); }
 
   // Functions to get internal box data
   unitval get_Tbox() const { return Tbox; };
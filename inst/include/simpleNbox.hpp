@@ -13,18 +13,16 @@
  *
  */
 
+#include "biome_history.hpp"
 #include "carbon-cycle-model.hpp"
+#include "flux_ledger.hpp"
 #include "fluxpool.hpp"
+#include "lognormal_cdf.hpp"
 #include "ocean_component.hpp"
 #include "temperature_component.hpp"
 #include "tseries.hpp"
 #include "unitval.hpp"
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Weverything"
-#include <boost/math/distributions/lognormal.hpp>
-#pragma clang diagnostic pop
-
 #define SNBOX_ATMOS 0
 #define SNBOX_VEG 1
 #define SNBOX_DET 2
@@ -35,6 +33,8 @@
 #define SNBOX_EARTH 7
 
 #define MB_EPSILON 0.001    //!< allowed tolerance for mass-balance checks, Pg C
+#define SNBOX_OMP_MIN_BIOMES                                                   \
+  100 //!< with OpenMP, split per-biome loops across threads from this size
 #define SNBOX_PARSECHAR "." //!< input separator between <biome> and <pool>
 #define SNBOX_DEFAULT_BIOME "global" //!< value if no biome supplied
 
@@ -85,8 +85,11 @@ public:
   // Carbon cycle model interface
   void getCValues(double t, double c[]);
   int calcderivs(double t, const double c[], double dcdt[]) const;
+  int calcjacobian(double t, const double c[], double J[]) const;
+  int calcfluxes(double t, const double c[], double F[]) const;
   void slowparameval(double t, const double c[]);
   void stashCValues(double t, const double c[]);
+  double max_stash_interval() const;
   void record_state(
       double t); //!< record the state variables at the end of the time step
 
@@ -97,10 +100,10 @@ public:
 private:
   virtual unitval getData(const std::string &varName, const double date);
 
-  // typedefs for two map types, to make things easier
-  // TODO: these should probably be defined in h_util.hpp or someplace similar?
-  typedef std::map<std::string, fluxpool> fluxpool_stringmap;
-  typedef std::map<std::string, double> double_stringmap;
+  // Per-biome quantities are stored densely, indexed by the biome's
+  // position in `biome_list`; see biome_idx()
+  typedef std::vector<fluxpool> fluxpool_biomes;
+  typedef std::vector<double> double_biomes;
 
   bool has_been_run_before; //!<  Has run() been called once already?
 
@@ -110,8 +113,10 @@ private:
    * step so that we can reset to any arbitrary past time.
    *****************************************************************/
 
-  // List of biomes
+  // Biome registry: `biome_list` maps a biome's index to its name and
+  // `biome_index` its name to its index
   std::vector<std::string> biome_list;
+  std::map<std::string, std::size_t> biome_index;
 
   // Carbon pools -- global
   fluxpool earth_c; //!< earth pool, Pg C; for mass-balance
@@ -119,33 +124,33 @@ private:
   double cumulative_pf_ch4; //!< cumulative release of CH4-C thawed permafrost, Pg C
   
   // Carbon pools -- biome-specific
-  fluxpool_stringmap veg_c;      //!< vegetation pools, Pg C
-  fluxpool_stringmap detritus_c; //!< detritus pools, Pg C
-  fluxpool_stringmap soil_c;     //!< soil pool, Pg C
+  fluxpool_biomes veg_c;      //!< vegetation pools, Pg C
+  fluxpool_biomes detritus_c; //!< detritus pools, Pg C
+  fluxpool_biomes soil_c;     //!< soil pool, Pg C
   // Permafrost functionality is documented in Woodard et al. 2021:
   // A permafrost implementation in the simple carbon–climate model Hector v.2.3pf,
   // http://dx.doi.org/10.5194/gmd-14-4751-2021
-  fluxpool_stringmap permafrost_c; //!< permafrost C pool, Pg C
+  fluxpool_biomes permafrost_c; //!< permafrost C pool, Pg C
   // Track thawed peramfrost separately from soil, so that
   // we can apply rh_ch4_frac (the CH4:CO2 ratio) to it
-  fluxpool_stringmap thawed_permafrost_c; //!< thawed permafrost pool, Pg C
+  fluxpool_biomes thawed_permafrost_c; //!< thawed permafrost pool, Pg C
 
   // Carbon fluxes -- biome-specific
-  fluxpool_stringmap NPP_veg; //!< Net primary productivity of vegetation;
-  fluxpool_stringmap RH_det,
+  fluxpool_biomes NPP_veg; //!< Net primary productivity of vegetation;
+  fluxpool_biomes RH_det,
       RH_soil; //!< Heterotrophic CO2 respiration of detritus and soil
-  fluxpool_stringmap RH_thawed_permafrost,
+  fluxpool_biomes RH_thawed_permafrost,
       RH_ch4; //!<  Heterotrophic CH4 respiration of thawed permafrost
-  fluxpool_stringmap
+  fluxpool_biomes
       final_npp; //!< final NPP after any NBP constraint accounted for, Pg C/yr
-  fluxpool_stringmap
+  fluxpool_biomes
       final_rh; //!< final RH after any NBP constraint accounted for, Pg C/yr
 
   // Other state variables
   unitval Ca_residual; //!< residual (when constraining [CO2]), Pg C
-  double_stringmap tempfertd,
+  double_biomes tempfertd,
       tempferts; //!< temperature effect on respiration (unitless)
-  double_stringmap f_frozen; //!< fraction of original permafrost that remains frozen
+  double_biomes f_frozen; //!< fraction of original permafrost that remains frozen
 
   /*****************************************************************
    * Records of component state
@@ -155,32 +160,32 @@ private:
    *****************************************************************/
   tseries<fluxpool> earth_c_ts; //!< Time series of earth C pool
   tseries<fluxpool> atmos_c_ts; //!< Time series of atmosphere C pool
-  tvector<fluxpool_stringmap>
+  biome_history<fluxpool>
       veg_c_tv; //!< Time series of biome-specific vegetation C pools
-  tvector<fluxpool_stringmap>
+  biome_history<fluxpool>
       detritus_c_tv; //!< Time series of biome-specific detritus C pools
-  tvector<fluxpool_stringmap>
+  biome_history<fluxpool>
       soil_c_tv; //!< Time series of biome-specific soil C pools
-  tvector<fluxpool_stringmap>
+  biome_history<fluxpool>
       permafrost_c_tv; //!< Time series of biome-specific permafrost C
                        //!< pools
-  tvector<fluxpool_stringmap>
+  biome_history<fluxpool>
       thawed_permafrost_c_tv; //!< Time series of biome-specific thawed
                               //!< permafrost
 
   // Time series versions of flux variables
-  tvector<fluxpool_stringmap> NPP_veg_tv, RH_det_tv, RH_soil_tv,
+  biome_history<fluxpool> NPP_veg_tv, RH_det_tv, RH_soil_tv,
       RH_thawed_permafrost_tv, RH_ch4_tv;
-  tvector<fluxpool_stringmap>
+  biome_history<fluxpool>
       final_npp_tv; //!< Time series of biome-specific final NPP
-  tvector<fluxpool_stringmap>
+  biome_history<fluxpool>
       final_rh_tv; //!< Time series of biome-specific final RH
 
   tseries<unitval> Ca_residual_ts; //!< Time series of residual flux values
 
-  tvector<double_stringmap> tempfertd_tv,
+  biome_history<double> tempfertd_tv,
       tempferts_tv; //!< Time series of temperature effect on respiration
-  tvector<double_stringmap>
+  biome_history<double>
       f_frozen_tv; //!< Time series of frozen permafrost fraction
 
   /*****************************************************************
@@ -190,8 +195,8 @@ private:
    * they do need to be recalculated whenever we reset.
    *****************************************************************/
 
-  double_stringmap co2fert;     //!< CO2 fertilization effect (unitless)
-  double_stringmap f_new_thaw;    //!< New thaw fraction (unitless)
+  double_biomes co2fert;     //!< CO2 fertilization effect (unitless)
+  double_biomes f_new_thaw;    //!< New thaw fraction (unitless)
   tseries<double> Tland_record; //!< Record of mean land surface/air temperature
                                 //!< values, for computing soil RH
   bool in_spinup;               //!< flag tracking spinup state
@@ -232,12 +237,12 @@ private:
    *****************************************************************/
 
   // Partitioning
-  double_stringmap f_nppv,
+  double_biomes f_nppv,
       f_nppd;                 //!< fraction NPP into vegetation and detritus
-  double_stringmap f_litterd; //!< fraction of litter to detritus
+  double_biomes f_litterd; //!< fraction of litter to detritus
 
   // Initial fluxes
-  fluxpool_stringmap npp_flux0; //!< preindustrial NPP
+  fluxpool_biomes npp_flux0; //!< preindustrial NPP
 
   // Variables needed to adjust NPP for LUC
   unitval cum_luc_va;
@@ -254,141 +259,151 @@ private:
       current_luc_u,      //!< Current year LUC uptake (Pg C/yr)
       current_ffi_e,      //!< Current year FFI emissions (Pg C/yr)
       current_daccs_u;    //!< Current year DACCS uptake (Pg C/yr)
-  double_stringmap beta;  //!< shape of CO2 response
-  double_stringmap
+  double_biomes beta;  //!< shape of CO2 response
+  double_biomes
       warmingfactor; //!< regional warming relative to global (1.0=same)
-  double_stringmap
+  double_biomes
       q10_rh; //!< Q10 for heterotrophic respiration (1.0=no response, unitless)
-  double_stringmap
+  double_biomes
       rh_ch4_frac; //!< Fraction of RH from thawed permafrost that is CH4
-  double_stringmap
+  double_biomes
       pf_sigma;           //!< Standard deviation for permafrost-temp model fit
-  double_stringmap pf_mu; //!< Mean for permafrost-temp model fit
-  double_stringmap fpf_static; //!< Permafrost C non-labile fraction
-  typedef std::map<std::string, boost::math::lognormal> lognormal_stringmap;
-  lognormal_stringmap pf_s; //!< Permafrost lognormal distribution
+  double_biomes pf_mu; //!< Mean for permafrost-temp model fit
+  double_biomes fpf_static; //!< Permafrost C non-labile fraction
+  std::vector<lognormal_cdf>
+      pf_s; //!< Permafrost lognormal distribution (its CDF)
 
   /*****************************************************************
    * Functions computing sub-elements of the carbon cycle
    *****************************************************************/
   fluxpool
   CO2_conc(double time = Core::undefinedIndex()) const; //!< current [CO2], ppmv
-  double calc_co2fert(std::string biome, double time = Core::undefinedIndex())
+  double calc_co2fert(std::size_t ib, double time = Core::undefinedIndex())
       const; //!< calculates co2 fertilization factor.
-  fluxpool npp(std::string biome, double time = Core::undefinedIndex())
+  fluxpool npp(std::size_t ib, double time = Core::undefinedIndex())
       const; //!< calculates NPP for a biome
   fluxpool sum_npp(double time = Core::undefinedIndex())
       const; //!< calculates NPP, global total
-  fluxpool rh_fda(std::string biome, double time = Core::undefinedIndex())
+  fluxpool rh_fda(std::size_t ib, double time = Core::undefinedIndex())
       const; //!< calculates RH from detritus for a biome
-  fluxpool rh_fsa(std::string biome, double time = Core::undefinedIndex())
+  fluxpool rh_fsa(std::size_t ib, double time = Core::undefinedIndex())
       const; //!< calculates RH from soil for a biome
-  fluxpool rh_ftpa_co2(std::string biome, double time = Core::undefinedIndex())
+  fluxpool rh_ftpa_co2(std::size_t ib, double time = Core::undefinedIndex())
       const; //!< calculates current CO2 RH from thawed permafrost for a biome
-  fluxpool rh_ftpa_ch4(std::string biome, double time = Core::undefinedIndex())
+  fluxpool rh_ftpa_ch4(std::size_t ib, double time = Core::undefinedIndex())
       const; //!< calculates current CH4 RH from thawed permafrost for a biome
   fluxpool
-  rh(std::string biome,
+  rh(std::size_t ib,
      double time = Core::undefinedIndex()) const; //!< calculates RH for a biome
   fluxpool sum_rh(double time = Core::undefinedIndex())
       const; //!< calculates RH, global total
-  tuple<double, double, double> compute_pf_thaw_refreeze(string biome,
-                                                         fluxpool rh_co2,
-                                                         fluxpool rh_ch4) const;
+  tuple<double, double, double>
+  compute_pf_thaw_refreeze(std::size_t ib, double permafrost, double thawed,
+                           double rh_co2, double rh_ch4) const;
+
+  //! Carbon fluxes between the pools at a point in a time step (Pg C/yr)
+  struct pool_fluxes {
+    double ffi_e, daccs_u, ch4ox;        //!< fossil and DACCS fluxes
+    double luc_e, luc_u;                 //!< land-use change totals
+    double luc_fva, luc_fda, luc_fsa;    //!< LUC emissions by pool
+    double luc_fav;                      //!< LUC uptake (to veg)
+    double ocean_uptake, ocean_release;  //!< atmosphere-ocean exchange
+    double npp, npp_fav, npp_fad, npp_fas; //!< NPP and its partitioning
+    double rh, rh_fda, rh_fsa;           //!< RH, from detritus and soil
+    double rh_ftpa_co2, rh_ftpa_ch4;     //!< RH from thawed permafrost
+    double litter, litter_fvd, litter_fvs; //!< litterfall from veg
+    double detsoil;                      //!< detritus to soil
+    double pf_thaw, pf_refreeze_tp, pf_refreeze_soil; //!< permafrost
+  };
+  int calc_pool_fluxes(double t, const double c[], pool_fluxes &fl) const;
+
+  // The biome terms of the fluxes depend only on the biome pools and the
+  // slowly-varying variables, which are fixed over a solver interval. They
+  // are computed by update_biome_fluxes() whenever those change, so that
+  // calc_pool_fluxes() need not loop over the biomes.
+  double_biomes npp_biome,                  //!< NPP, Pg C/yr
+      rh_fda_biome, rh_fsa_biome,           //!< RH from detritus and soil
+      rh_ftpa_co2_biome, rh_ftpa_ch4_biome; //!< RH from thawed permafrost
+  pool_fluxes biome_totals; //!< biome fluxes summed over biomes
+  double rh_biome_total;    //!< total RH, summed biome by biome as sum_rh()
+  void update_biome_fluxes();
+
+  //! Global quantities the biome pools are updated from in stashCValues()
+  struct land_update {
+    double yf;             //!< fraction of the year being stashed
+    double total;          //!< solver's veg + detritus + soil C, Pg C
+    double luc_e, luc_u;   //!< land-use change emission and uptake, Pg C/yr
+    double npp;            //!< NPP after any NBP constraint, Pg C/yr
+    double npp_rh;         //!< NPP + RH before any NBP constraint, Pg C/yr
+    double rh_adjust;      //!< NBP constraint adjustment of RH
+    double permafrost;     //!< permafrost C before the update, Pg C
+    double veg, det, soil; //!< solver's new pools (after any NBP
+    double permafrost_new, thawed; //!< constraint), Pg C
+  };
+  // Per-biome working arrays for update_land_pools(); members so that they
+  // are only allocated when the number of biomes changes
+  struct land_update_work {
+    double_biomes wt, wt_pf;                      //!< apportionment weights
+    double_biomes veg, det, soil, pf, tpf;        //!< pools, Pg C
+    double_biomes luc_fva, luc_fda, luc_fsa;      //!< LUC emissions, Pg C
+    double_biomes npp, npp_fav, npp_fad, npp_fas; //!< NPP (Pg C/yr), fluxes
+    double_biomes rh, rh_fda, rh_fsa, rh_co2, rh_ch4; //!< RH (Pg C/yr), fluxes
+    double_biomes rh_co2_adj, rh_ch4_adj; //!< thawed permafrost RH, Pg C/yr
+    double_biomes pf_thaw, pf_refreeze_tp, pf_refreeze_soil; //!< Pg C
+    double_biomes litter_fvd, litter_fvs, detsoil;            //!< Pg C
+  } luw;
+  bool update_land_pools(const land_update &lu);
 
   /*****************************************************************
    * Private helper functions
    *****************************************************************/
-  fluxpool sum_map(fluxpool_stringmap pool)
-      const; //!< sums a unitval map (collection of data)
+  fluxpool sum_map(const fluxpool_biomes &pool)
+      const; //!< sums a per-biome fluxpool vector
   double sum_map(
-      double_stringmap pool) const; //!< sums a double map (collection of data)
+      const double_biomes &pool) const; //!< sums a per-biome double vector
   void log_pools(const double t,
                  const string msg); //!< prints pool status to the log file
   void set_c0(double newc0); //!< set initial co2 and adjust total carbon mass
-  fluxpool sum_fluxpool_biome_ts(const string varName, const double date,
-                                 const string biome, fluxpool_stringmap pool,
-                                 tvector<fluxpool_stringmap> pool_tv);
-  bool has_biome(const std::string &biome);
+  unitval sum_fluxpool_biome_ts(const string &varName, const double date,
+                                const string &biome,
+                                const fluxpool_biomes &pool,
+                                const biome_history<fluxpool> &pool_tv);
+  bool has_biome(const std::string &biome) const;
+  std::size_t biome_idx(const std::string &biome) const;
+  void add_biome_slot(const std::string &biome);
+  void remove_biome_slot(std::size_t ib);
   double f_frozen_weighted_mean(const string biome, const double date);
 
   OceanComponent *omodel; //!< pointer to the ocean model in use
 
-  // Add a biome to a time-series map variable (e.g. veg_c_tv)
-  template <class T_data>
-  void add_biome_to_ts(tvector<std::map<std::string, T_data>> &ts,
-                       const std::string &biome, T_data init_value) {
-    // First, check if a biome of this name already exists in the data
-    if (ts.get(ts.firstdate()).count(biome)) {
-      H_THROW("Biome '" + biome + "' already exists in data.");
-    }
-
-    // Loop over time steps, and set the variable to the provided `init_value`
-    std::map<std::string, T_data> newval;
-    for (double i = ts.firstdate(); i < ts.lastdate(); i++) {
-      if (ts.exists(i)) {
-        newval = ts.get(i);
-        newval[biome] = init_value;
-        ts.set(i, newval);
-      }
-    }
-  }
-
-  // Remove a biome from a time-series map variable
-  template <class T_map>
-  void remove_biome_from_ts(tvector<T_map> &ts, const std::string &biome) {
-    // We don't need to check for presence of `biome` here because the
-    // `<std::map>.erase()` method is effectively a no-op when given a
-    // non-existent key.
-    T_map currval;
-    for (double i = ts.firstdate(); i < ts.lastdate(); i++) {
-      if (ts.exists(i)) {
-        currval = ts.get(i);
-        currval.erase(biome);
-        ts.set(i, currval);
-      }
-    }
-  }
-
-  // Rename a biome in a time-series map variable. At each time
-  // step, this creates a new biome called `newname`, gives it all
-  // of the values of `oldname`, and then erases that time step's
-  // `oldname`.
-  template <class T_map>
-  void rename_biome_in_ts(tvector<T_map> &ts, const std::string &oldname,
-                          const std::string &newname) {
-    if (!ts.get(ts.firstdate()).count(oldname)) {
-      H_THROW("Biome '" + oldname + "' not found in data.");
-    }
-    if (ts.get(ts.firstdate()).count(newname)) {
-      H_THROW("Biome '" + newname + "' already exists in data.");
-    }
-
-    T_map currval;
-    for (double i = ts.firstdate(); i < ts.lastdate(); i++) {
-      if (ts.exists(i)) {
-        currval = ts.get(i);
-        currval[newname] = currval.at(oldname);
-        currval.erase(oldname);
-        ts.set(i, currval);
-      }
-    }
-  }
-
   /*****************************************************************
    * Tracking Helper Functions
    *****************************************************************/
+  source_limits tracking_limits; //!< tracking controls, when tracking starts
+  void limit_tracked_sources();
   void start_tracking() {
     earth_c.tracking = true;
     atmos_c.tracking = true;
-    for (auto biome : biome_list) {
-      veg_c[biome].tracking = true;
-      detritus_c[biome].tracking = true;
-      soil_c[biome].tracking = true;
-      permafrost_c[biome].tracking = true;
-      thawed_permafrost_c[biome].tracking = true;
+    for (std::size_t ib = 0; ib < biome_list.size(); ++ib) {
+      veg_c[ib].tracking = true;
+      detritus_c[ib].tracking = true;
+      soil_c[ib].tracking = true;
+      permafrost_c[ib].tracking = true;
+      thawed_permafrost_c[ib].tracking = true;
     }
   }
+
+  // With the ledger tracking engine (Core::trackingByLedger()) the fluxes
+  // between the pools are recorded in a ledger as the model runs, and their
+  // sources found from it afterwards, instead of by the fluxpools
+  flux_ledger ledger;
+  struct ledger_pools {
+    std::size_t atmos, earth;
+    std::vector<std::size_t> veg, det, soil, pf, tpf; //!< by biome
+  } lp; //!< the ledger's index of each pool
+  void start_ledger(double t);
+  void record_land_fluxes(std::size_t nbiome, double luc_fav);
+  void record_ledger_sizes();
 };
 
 } // namespace Hector
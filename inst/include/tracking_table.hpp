@@ -0,0 +1,54 @@
+/* Hector -- A Simple Climate Model
+   Copyright (C) 2022  Battelle Memorial Institute
+
+   Please see the accompanying file LICENSE.md for additional licensing
+   information.
+*/
+#ifndef TRACKING_TABLE_H
+#define TRACKING_TABLE_H
+/*
+ *  tracking_table.hpp
+ *  hector
+ *
+ *  The carbon tracking data as typed columns, for callers (e.g. the R
+ *  package) that would otherwise have to parse the csv text.
+ *
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Hector {
+
+//-----------------------------------------------------------------------
+/*! \brief Carbon tracking data, one entry per row in each column
+ *
+ *  Component, pool, units and source names are coded: each row holds an
+ *  index into the matching list of levels, in order of first appearance,
+ *  so they map directly onto factors. The columns are those of the csv
+ *  tracking output.
+ */
+struct tracking_table {
+  std::vector<double> year;
+  std::vector<int> component; //!< index into components
+  std::vector<int> pool;      //!< index into pools
+  std::vector<double> pool_value; //!< in the row's units
+  std::vector<int> unit;          //!< index into units
+  std::vector<int> source;        //!< index into sources
+  std::vector<double> fraction;
+
+  std::vector<std::string> components, pools, units, sources;
+
+  //! Number of rows
+  std::size_t size() const { return year.size(); }
+
+  void add_row(double yr, int comp, int pl, double value, int un, int src,
+               double frac);
+  static int add_level(std::vector<std::string> &levels,
+                       const std::string &name);
+};
+
+} // namespace Hector
+
+#endif // TRACKING_TABLE_H
@@ -14,6 +14,7 @@
  *
  */
 
+#include <iterator>
 #include <limits>
 #include <map>
 #include <sstream>
@@ -28,18 +29,30 @@ namespace Hector {
 
 /*! \brief Time series data type.
  *
- *  Currently implemented as an STL map.
+ *  Currently implemented as an STL map.  Truncating the end of the series
+ *  only lowers a high-water mark; the entries beyond it are hidden from all
+ *  accessors and are overwritten in place as the series is refilled, so a
+ *  model reset does not have to free and reallocate its history.
  */
 template <class T_data> class tseries {
   std::map<double, T_data> mapdata;
   double lastInterpYear;
   bool endinterp_allowed;
   mutable bool dirty; // does series need re-interpolating?
+  double hwm;         // last valid date; entries after this are stale
 
   h_interpolator interpolator;
   void set_interp(double, bool, interpolation_methods);
   void fit_spline();
 
+  bool stale() const {
+    return !mapdata.empty() && mapdata.rbegin()->first > hwm;
+  }
+  typename std::map<double, T_data>::const_iterator valid_end() const {
+    return stale() ? mapdata.upper_bound(hwm) : mapdata.end();
+  }
+  void compact();
+
 public:
   tseries();
 
@@ -281,6 +294,7 @@ template <class T_data> tseries<T_data>::tseries() {
   set_interp(std::numeric_limits<double>::min(), false,
              DEFAULT); // default values
   dirty = false;
+  hwm = std::numeric_limits<double>::infinity();
   name = "?";
 }
 
@@ -290,6 +304,12 @@ template <class T_data> tseries<T_data>::tseries() {
  *  Sets an (t, d) tuple, data d at time t.
  */
 template <class T_data> void tseries<T_data>::set(double t, T_data d) {
+  if (t > hwm) {
+    // Moving the high-water mark forward: anything stale that we skip
+    // over would otherwise reappear, so drop it first.
+    mapdata.erase(mapdata.upper_bound(hwm), mapdata.lower_bound(t));
+    hwm = t;
+  }
   mapdata[t] = d;
   if (t < lastInterpYear) {
     dirty = true;
@@ -302,7 +322,7 @@ template <class T_data> void tseries<T_data>::set(double t, T_data d) {
  *  Returns a bool to indicate if data exists.
  */
 template <class T_data> bool tseries<T_data>::exists(double t) const {
-  return (mapdata.find(t) != mapdata.end());
+  return t <= hwm && (mapdata.find(t) != mapdata.end());
 }
 
 //-----------------------------------------------------------------------
@@ -315,17 +335,23 @@ template <class T_data> bool tseries<T_data>::exists(double t) const {
  *  as a constant (i.e, return the single value that we have).
  */
 template <class T_data> T_data tseries<T_data>::get(double t) const {
-  if (mapdata.size() == 1) {
+  typename std::map<double, T_data>::const_iterator vend = valid_end();
+  if (mapdata.begin() != vend && std::next(mapdata.begin()) == vend) {
     return mapdata.begin()->second;
   }
   typename std::map<double, T_data>::const_iterator itr = mapdata.find(t);
-  if (itr != mapdata.end())
+  if (itr != mapdata.end() && t <= hwm)
     return (*itr).second;
-  else if (t < lastInterpYear)
+  else if (t < lastInterpYear) {
+    if (stale()) {
+      // The series was truncated and has not been refilled yet; drop the
+      // hidden entries so the interpolator can't see them.
+      const_cast<tseries *>(this)->compact();
+    }
     return interp_helper<T_data>::interp(
         mapdata, const_cast<tseries *>(this)->interpolator, name, dirty,
         endinterp_allowed, t);
-  else {
+  } else {
     std::ostringstream errmsg;
     errmsg << "Interpolation requested but not allowed (" << name
            << ") date: " << t << "\n";
@@ -340,6 +366,9 @@ template <class T_data> T_data tseries<T_data>::get(double t) const {
  *
  */
 template <class T_data> T_data tseries<T_data>::get_deriv(double t) const {
+  if (stale()) {
+    const_cast<tseries *>(this)->compact();
+  }
   if (mapdata.size() == 1) {
     H_THROW("More than one data point needed to calculate a derivative");
   }
@@ -395,7 +424,7 @@ template <class T_data> void tseries<T_data>::allowPartialInterp(bool eia) {
  *  Return index of first element in series.
  */
 template <class T_data> double tseries<T_data>::firstdate() const {
-  H_ASSERT(!mapdata.empty(), "no mapdata");
+  H_ASSERT(mapdata.begin() != valid_end(), "no mapdata");
   return (*mapdata.begin()).first;
 }
 
@@ -405,8 +434,9 @@ template <class T_data> double tseries<T_data>::firstdate() const {
  *  Return index of last element in series.
  */
 template <class T_data> double tseries<T_data>::lastdate() const {
-  H_ASSERT(!mapdata.empty(), "no mapdata");
-  return (*mapdata.rbegin()).first;
+  typename std::map<double, T_data>::const_iterator vend = valid_end();
+  H_ASSERT(mapdata.begin() != vend, "no mapdata");
+  return (*std::prev(vend)).first;
 }
 
 //-----------------------------------------------------------------------
@@ -415,7 +445,18 @@ template <class T_data> double tseries<T_data>::lastdate() const {
  *  Return size of series.
  */
 template <class T_data> int tseries<T_data>::size() const {
-  return int(mapdata.size());
+  if (!stale())
+    return int(mapdata.size());
+  return int(std::distance(mapdata.begin(), valid_end()));
+}
+
+//-----------------------------------------------------------------------
+/*! \brief Physically remove entries hidden by the high-water mark.
+ */
+template <class T_data> void tseries<T_data>::compact() {
+  mapdata.erase(mapdata.upper_bound(hwm), mapdata.end());
+  hwm = std::numeric_limits<double>::infinity();
+  dirty = true;
 }
 
 /*! \brief truncate a time series
@@ -423,7 +464,9 @@ template <class T_data> int tseries<T_data>::size() const {
  *  \details The default is to wipe all of the data in the time series
  *           after the input date.  By setting the optional after
  *           argument to false, you can wipe data before the input
- *           date instead.
+ *           date instead.  Wiping the end of the series is constant
+ *           time: it only lowers the high-water mark, and the hidden
+ *           entries are reused by subsequent calls to set().
  *  \note If you're going to overwrite previously read-in data, and
  *        you're not supplying input at every year, then you need to
  *        trigger this function (probably by sending a M_TRUNCATE
@@ -443,15 +486,15 @@ template <class T_data> int tseries<T_data>::size() const {
  *        compatible with whatever GCAM is doing.
  */
 template <class T> void tseries<T>::truncate(double t, bool after) {
-  typename std::map<double, T>::iterator it1, it2;
   if (after) {
-    it1 = mapdata.upper_bound(t);
-    it2 = mapdata.end();
+    if (t < hwm) {
+      hwm = t;
+      dirty = true;
+    }
   } else {
-    it1 = mapdata.begin();
-    it2 = mapdata.lower_bound(t);
+    mapdata.erase(mapdata.begin(), mapdata.lower_bound(t));
+    dirty = true;
   }
-  mapdata.erase(it1, it2);
 }
 
 } // namespace Hector
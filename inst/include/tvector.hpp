@@ -26,7 +26,9 @@
  *
  */
 
+#include <algorithm>
 #include <cmath>
+#include <iterator>
 #include <limits>
 #include <map>
 #include <sstream>
@@ -39,10 +41,20 @@ namespace Hector {
 
 /*! \brief Time vector data type.
  *
- *  Currently implemented as an STL map.
+ *  Currently implemented as an STL map.  As with tseries, truncating the
+ *  end of the vector only lowers a high-water mark, and the hidden entries
+ *  are overwritten in place when the vector is refilled.
  */
 template <class T_data> class tvector {
   std::map<double, T_data> mapdata;
+  double hwm = std::numeric_limits<double>::infinity(); // last valid date
+
+  bool stale() const {
+    return !mapdata.empty() && mapdata.rbegin()->first > hwm;
+  }
+  typename std::map<double, T_data>::const_iterator valid_end() const {
+    return stale() ? mapdata.upper_bound(hwm) : mapdata.end();
+  }
 
 public:
   void set(double, const T_data &);
@@ -81,7 +93,13 @@ private:
  *  Sets an (t, d) tuple, data d at time t.
  */
 template <class T_data> void tvector<T_data>::set(double t, const T_data &d) {
-  mapdata[round(t)] = d;
+  t = round(t);
+  if (t > hwm) {
+    // skip over stale entries that would otherwise become visible again
+    mapdata.erase(mapdata.upper_bound(hwm), mapdata.lower_bound(t));
+    hwm = t;
+  }
+  mapdata[t] = d;
 }
 
 //-----------------------------------------------------------------------
@@ -90,7 +108,8 @@ template <class T_data> void tvector<T_data>::set(double t, const T_data &d) {
  *  Returns a bool to indicate if data exists.
  */
 template <class T_data> bool tvector<T_data>::exists(double t) const {
-  return (mapdata.find(round(t)) != mapdata.end());
+  t = round(t);
+  return t <= hwm && (mapdata.find(t) != mapdata.end());
 }
 
 //-----------------------------------------------------------------------
@@ -102,7 +121,7 @@ template <class T_data> bool tvector<T_data>::exists(double t) const {
 template <class T_data> const T_data &tvector<T_data>::get(double t) const {
   typename std::map<double, T_data>::const_iterator itr =
       mapdata.find(round(t));
-  if (itr != mapdata.end())
+  if (itr != mapdata.end() && itr->first <= hwm)
     return (*itr).second;
   else {
     std::ostringstream errmsg;
@@ -118,7 +137,7 @@ template <class T_data> const T_data &tvector<T_data>::get(double t) const {
  */
 template <class T_data> T_data &tvector<T_data>::get(double t) {
   typename std::map<double, T_data>::iterator itr = mapdata.find(round(t));
-  if (itr != mapdata.end())
+  if (itr != mapdata.end() && itr->first <= hwm)
     return itr->second;
   else {
     std::ostringstream errmsg;
@@ -144,7 +163,7 @@ template <class T_data> T_data &tvector<T_data>::operator[](double t) {
  *  Return index of first element in vector.
  */
 template <class T_data> double tvector<T_data>::firstdate() const {
-  H_ASSERT(!mapdata.empty(), "no mapdata");
+  H_ASSERT(mapdata.begin() != valid_end(), "no mapdata");
   return (*mapdata.begin()).first;
 }
 
@@ -154,8 +173,9 @@ template <class T_data> double tvector<T_data>::firstdate() const {
  *  Return index of last element in vector.
  */
 template <class T_data> double tvector<T_data>::lastdate() const {
-  H_ASSERT(!mapdata.empty(), "no mapdata");
-  return (*mapdata.rbegin()).first;
+  typename std::map<double, T_data>::const_iterator vend = valid_end();
+  H_ASSERT(mapdata.begin() != vend, "no mapdata");
+  return (*std::prev(vend)).first;
 }
 
 //-----------------------------------------------------------------------
@@ -164,7 +184,9 @@ template <class T_data> double tvector<T_data>::lastdate() const {
  *  Return size of vector.
  */
 template <class T_data> int tvector<T_data>::size() const {
-  return int(mapdata.size());
+  if (!stale())
+    return int(mapdata.size());
+  return int(std::distance(mapdata.begin(), valid_end()));
 }
 
 /*! \brief truncate a time vector
@@ -172,19 +194,16 @@ template <class T_data> int tvector<T_data>::size() const {
  *  \details The default is to wipe all of the data in the time vector
  *           after the input date.  By setting the optional after
  *           argument to false, you can wipe data before the input
- *           date instead.
+ *           date instead.  Wiping the end of the vector is constant
+ *           time; see tseries::truncate.
  */
 template <class T> void tvector<T>::truncate(double t, bool after) {
   t = round(t);
-  typename std::map<double, T>::iterator it1, it2;
   if (after) {
-    it1 = mapdata.upper_bound(t);
-    it2 = mapdata.end();
+    hwm = std::min(hwm, t);
   } else {
-    it1 = mapdata.begin();
-    it2 = mapdata.lower_bound(t);
+    mapdata.erase(mapdata.begin(), mapdata.lower_bound(t));
   }
-  mapdata.erase(it1, it2);
 }
 
 } // namespace Hector